@@ -73,21 +73,100 @@ void forget_intrep(Tcl_Obj* obj) //<<<
 
 // ip_objtype <<<
 struct ip_info {
-	int		af;		// AF_INET (ipv4) or AF_INET6 (ipv6)
-	int16_t	netbits;
-	uint8_t	normalized;
+	uint8_t		af;			// AF_INET (ipv4) or AF_INET6 (ipv6)
+	int16_t		netbits;	// -1 for a range (only while compiling a networks list)
+	uint32_t	refCount;	// Number of ip_objtype intreps sharing this interned ip_info
 	union {
 		struct in_addr	ipv4;
 		struct in6_addr	ipv6;
 	};
-	uint64_t	skey;
 };
 
-static void free_ip_info(struct ip_info* ip) //<<<
+// Ranges are only accepted in networks lists, which parse straight into their
+// intervals, so the last address (inclusive) is only needed while parsing
+struct ip_range {
+	struct ip_info	ip;
+	union {
+		struct in_addr	ipv4;
+		struct in6_addr	ipv6;
+	} last;
+};
+#define IP_LAST(ip)		(((struct ip_range*)(ip))->last)
+
+// Interned ip_infos live in the key of their g_ip_intern entry, hashed and
+// compared on (af, netbits, address), so each distinct address is a single
+// allocation no bigger than the ip_info alone used to be once allocator overhead
+// is counted (keep struct ip_info at 24 bytes).  The table is weak: it doesn't
+// hold a reference, and the entry is removed when the last intrep referencing it
+// is freed
+static Tcl_HashTable	g_ip_intern;
+
+static size_t ip_addr_size(const struct ip_info* ip) //<<<
+{
+	return ip->af == AF_INET ? sizeof(struct in_addr) : sizeof(struct in6_addr);
+}
+
+//>>>
+static TCL_HASH_TYPE hash_ip_info(Tcl_HashTable* tablePtr, void* keyPtr) //<<<
+{
+	const struct ip_info*	ip = keyPtr;
+	TCL_HASH_TYPE			hash = ip->af ^ (TCL_HASH_TYPE)ip->netbits << 8;
+	const uint8_t*			p = (const uint8_t*)&ip->ipv6;
+
+	for (size_t i=0; i<ip_addr_size(ip); i++)
+		hash += (hash << 3) + p[i];
+
+	return hash;
+}
+
+//>>>
+static int compare_ip_info(void* keyPtr, Tcl_HashEntry* hPtr) //<<<
 {
-	if (ip) {
-		// Free anything dynamic in ip_info (nothing yet)
-		ckfree(ip);
+	const struct ip_info*	a = keyPtr;
+	const struct ip_info*	b = (const struct ip_info*)hPtr->key.string;
+
+	return
+		a->af == b->af &&
+		a->netbits == b->netbits &&
+		memcmp(&a->ipv6, &b->ipv6, ip_addr_size(a)) == 0;
+}
+
+//>>>
+static Tcl_HashEntry* alloc_ip_info_entry(Tcl_HashTable* tablePtr, void* keyPtr) //<<<
+{
+	// Like TCL_STRING_KEYS, the key is stored inline in the entry, so the entry is the ip_info's only allocation
+	const struct ip_info*	ip = keyPtr;
+	Tcl_HashEntry*			hPtr = ckalloc(offsetof(Tcl_HashEntry, key) + sizeof(struct ip_info));
+
+	memcpy(hPtr->key.string, ip, sizeof(struct ip_info));
+	((struct ip_info*)hPtr->key.string)->refCount = 0;
+	hPtr->clientData = NULL;
+
+	return hPtr;
+}
+
+//>>>
+static const Tcl_HashKeyType ip_info_keytype = {
+	.version			= TCL_HASH_KEY_TYPE_VERSION,
+	.hashKeyProc		= hash_ip_info,
+	.compareKeysProc	= compare_ip_info,
+	.allocEntryProc		= alloc_ip_info_entry
+};
+
+static struct ip_info* intern_ip_info(const struct ip_info* parsed) //<<<
+{
+	int				new = 0;
+	Tcl_HashEntry*	he = Tcl_CreateHashEntry(&g_ip_intern, parsed, &new);
+
+	return Tcl_GetHashKey(&g_ip_intern, he);
+}
+
+//>>>
+static void release_ip_info(struct ip_info* ip) //<<<
+{
+	if (ip && --ip->refCount == 0) {
+		// Frees ip along with its entry
+		Tcl_DeleteHashEntry((Tcl_HashEntry*)((char*)ip - offsetof(Tcl_HashEntry, key)));
 		ip = NULL;
 	}
 }
@@ -109,21 +188,21 @@ static void free_ip_internal_rep(Tcl_Obj* obj) //<<<
 {
 	Tcl_ObjInternalRep*	ir = Tcl_FetchInternalRep(obj, &ip_objtype);
 	forget_intrep(obj);
-	free_ip_info((struct ip_info*)ir->twoPtrValue.ptr1);
+	release_ip_info((struct ip_info*)ir->twoPtrValue.ptr1);
 }
 
 //>>>
 static void dup_ip_internal_rep(Tcl_Obj* src, Tcl_Obj* dst) //<<<
 {
 	Tcl_ObjInternalRep*	ir = Tcl_FetchInternalRep(src, &ip_objtype);
-	struct ip_info* src_ip = (struct ip_info*)ir->twoPtrValue.ptr1;
-	
-	// Create a copy of the ip_info structure
-	struct ip_info* dst_ip = ckalloc(sizeof(*dst_ip));
-	*dst_ip = *src_ip;  // Copy all fields
-	
-	// Store the new internal rep in the destination object
-	Tcl_StoreInternalRep(dst, &ip_objtype, &(Tcl_ObjInternalRep){.twoPtrValue.ptr1 = dst_ip});
+	struct ip_info*		ip = (struct ip_info*)ir->twoPtrValue.ptr1;
+
+	// Share the interned ip_info.  dst gets a copy of src's string rep, so it inherits the normalized flag too
+	ip->refCount++;
+	Tcl_StoreInternalRep(dst, &ip_objtype, &(Tcl_ObjInternalRep){
+			.twoPtrValue.ptr1	= ip,
+			.twoPtrValue.ptr2	= ir->twoPtrValue.ptr2
+	});
 	register_intrep(dst); // Register the new object in the intrep table
 }
 
@@ -163,16 +242,239 @@ static void update_ip_string_rep(Tcl_Obj* obj) //<<<
 	// Initialize the string representation
 	Tcl_InitStringRep(obj, Tcl_DStringValue(&ds), bufend);
 	Tcl_DStringFree(&ds);
-	ip->normalized = 1;
+	ir->twoPtrValue.ptr2 = (void*)1;	// Flag this object's string rep as normalized (can't go on the shared ip_info)
+}
+
+//>>>
+static void set_ip_intrep(Tcl_Obj* obj, struct ip_info* ip) //<<<
+{
+	ip->refCount++;
+	Tcl_StoreInternalRep(obj, &ip_objtype, &(Tcl_ObjInternalRep){.twoPtrValue.ptr1 = ip});
+	register_intrep(obj);
+}
+
+//>>>
+static Tcl_Obj* new_ip_obj(struct ip_info* ip) //<<<
+{
+	Tcl_Obj*	obj = Tcl_NewObj();
+
+	Tcl_InvalidateStringRep(obj);	// String rep will be generated (normalized) from the intrep on demand
+	set_ip_intrep(obj, ip);
+	return obj;
 }
 
 //>>>
 
+static int parse_addr(Tcl_Interp* interp, int af, const char* start, const char* end, void* dst) //<<<
+{
+	int		code = TCL_OK;
+	char	ip_part[INET6_ADDRSTRLEN > INET_ADDRSTRLEN ? INET6_ADDRSTRLEN : INET_ADDRSTRLEN];
+	size_t	addr_len = end - start;
+
+	if (addr_len >= sizeof(ip_part))
+		THROW_ERROR_LABEL(finally, code, "IP address too long");
+
+	memcpy(ip_part, start, addr_len);
+	ip_part[addr_len] = '\0';
+
+	if (1 != inet_pton(af, ip_part, dst))
+		THROW_PRINTF_LABEL(finally, code, "inet_pton failed to parse \"%s\"", ip_part);
+
+finally:
+	return code;
+}
+
+//>>>
+static int is_v4mapped(const struct in6_addr* addr) //<<<
+{
+	return
+		*(uint64_t*)addr->s6_addr == 0 &&
+		addr->s6_addr[8] == 0 &&
+		addr->s6_addr[9] == 0 &&
+		addr->s6_addr[10] == 0xff &&
+		addr->s6_addr[11] == 0xff;
+}
+
+//>>>
+static void convert_v4mapped(struct ip_info* ip) //<<<
+{
+	// Convert IPv4-in-IPv6 address to IPv4.  The alternative would be to convert all IPv4 addresses to IPv6
+	// which would simplify the later comparisons but would be less efficient for the IPv4 case, which is
+	// overwhelmingly more common.
+	if (
+			ip->af == AF_INET6 &&
+			ip->netbits >= 96 &&
+			is_v4mapped(&ip->ipv6)
+	) {
+		memcpy(&ip->ipv4, &ip->ipv6.s6_addr[12], sizeof(ip->ipv4));
+		ip->af = AF_INET;
+		ip->netbits -= 96;
+	} else if (
+			ip->af == AF_INET6 &&
+			ip->netbits < 0 &&
+			is_v4mapped(&ip->ipv6) &&
+			is_v4mapped(&IP_LAST(ip).ipv6)
+	) {
+		memcpy(&ip->ipv4,         &ip->ipv6.s6_addr[12],         sizeof(ip->ipv4));
+		memcpy(&IP_LAST(ip).ipv4, &IP_LAST(ip).ipv6.s6_addr[12], sizeof(IP_LAST(ip).ipv4));
+		ip->af = AF_INET;
+	}
+}
+
+//>>>
+// Compiled form of a networks list: every entry (CIDR, range or wildcard) as an
+// inclusive address interval, sorted and merged so that the intervals for each
+// address family are disjoint and non-adjacent
+struct interval4 {
+	uint32_t	lo;		// Host byte order
+	uint32_t	hi;
+};
+struct interval6 {
+	uint8_t		lo[16];	// Network byte order, so memcmp orders them
+	uint8_t		hi[16];
+};
+struct networks_info {
+	Tcl_Obj*			network;	// The list's element if it had exactly one, otherwise NULL
+	Tcl_Size			count4;
+	struct interval4*	v4;
+	Tcl_Size			count6;
+	struct interval6*	v6;
+};
+
+static int parse_ip(Tcl_Interp* interp, Tcl_Obj* obj, int network_syntax, struct ip_range* parsed) //<<<
+{
+	// Parse obj's string rep into parsed, without interning it or touching obj's
+	// intrep.  Ranges and wildcards are only accepted if network_syntax is set
+	int						code = TCL_OK;
+	struct ip_info*			ip = &parsed->ip;
+	const char*				str = Tcl_GetString(obj);
+	const unsigned char*	s = (const unsigned char*)str;
+	const unsigned char		*ns, *ae, *rs, *YYMARKER;
+	enum {SPEC_CIDR, SPEC_RANGE, SPEC_WILDCARD}	spec = SPEC_CIDR;
+
+	*parsed = (struct ip_range){0};
+	/*!stags:re2c format = "const unsigned char* @@;\n"; */
+	for (;;) {
+		/*!re2c
+			re2c:yyfill:enable		= 0;
+			re2c:define:YYCTYPE		= "unsigned char";
+			re2c:define:YYCURSOR	= "s";
+			re2c:flags:tags			= 1;
+
+			end			= [\x00];
+			digit		= [0-9];
+			hexdigit	= [0-9a-fA-F];
+			dec_octet
+				= digit
+				| [1-9] digit
+				| "1" digit{2}
+				| "2" [0-4] digit
+				| "25" [0-5];
+			ipv4address	= dec_octet "." dec_octet "." dec_octet "." dec_octet;
+			h16			= hexdigit{1,4};
+			ls32		= h16 ":" h16 | ipv4address;
+			ipv6address
+				=                            (h16 ":"){6} ls32
+				|                       "::" (h16 ":"){5} ls32
+				| (               h16)? "::" (h16 ":"){4} ls32
+				| ((h16 ":"){0,1} h16)? "::" (h16 ":"){3} ls32
+				| ((h16 ":"){0,2} h16)? "::" (h16 ":"){2} ls32
+				| ((h16 ":"){0,3} h16)? "::"  h16 ":"     ls32
+				| ((h16 ":"){0,4} h16)? "::"              ls32
+				| ((h16 ":"){0,5} h16)? "::"              h16
+				| ((h16 ":"){0,6} h16)? "::";
+			netbits		= "/" @ns digit{1,3};
+			wildcard4	= (dec_octet "."){0,3} "*" (".*"){0,3};
+
+			ipv4address @ae netbits? end				{ ip->af = AF_INET;  spec = SPEC_CIDR;     break; }
+			ipv6address @ae netbits? end				{ ip->af = AF_INET6; spec = SPEC_CIDR;     break; }
+			ipv4address @ae "-" @rs ipv4address end		{ ip->af = AF_INET;  spec = SPEC_RANGE;    break; }
+			ipv6address @ae "-" @rs ipv6address end		{ ip->af = AF_INET6; spec = SPEC_RANGE;    break; }
+			wildcard4 end								{ ip->af = AF_INET;  spec = SPEC_WILDCARD; break; }
+			* { THROW_PRINTF_LABEL(finally, code, "Can't parse IP \"%s\"", Tcl_GetString(obj)); }
+		*/
+	}
+
+	if (spec != SPEC_CIDR && !network_syntax)
+		THROW_PRINTF_LABEL(finally, code, "Can't parse IP \"%s\": ranges and wildcards are only valid in networks lists", str);
+
+	switch (spec) {
+		case SPEC_CIDR: //<<<
+			// Parse just the address part (without netbits) using the ae tag
+			TEST_OK_LABEL(finally, code, parse_addr(interp, ip->af, str, (const char*)ae,
+						ip->af == AF_INET ? &ip->ipv4 : (struct in_addr*)&ip->ipv6));
+
+			if (ns) {
+				const char*	netbits_str = (const char*)ns;
+				ip->netbits = (int)strtol(netbits_str, NULL, 10);
+
+				// Validate netbits range based on address family
+				if (ip->af == AF_INET) {
+					if (ip->netbits < 0 || ip->netbits > 32)
+						THROW_PRINTF_LABEL(finally, code, "Invalid netbits for IPv4: %d (must be 0-32)", ip->netbits);
+				} else if (ip->af == AF_INET6) {
+					if (ip->netbits < 0 || ip->netbits > 128)
+						THROW_PRINTF_LABEL(finally, code, "Invalid netbits for IPv6: %d (must be 0-128)", ip->netbits);
+				}
+			} else {
+				ip->netbits = ip->af == AF_INET ? 32 : 128; // Default to host bits
+			}
+			break;
+			//>>>
+		case SPEC_RANGE: //<<<
+			{
+				// First address is up to the ae tag, the last address from the rs tag to the end
+				int	order;
+				if (ip->af == AF_INET) {
+					TEST_OK_LABEL(finally, code, parse_addr(interp, AF_INET, str, (const char*)ae, &ip->ipv4));
+					TEST_OK_LABEL(finally, code, parse_addr(interp, AF_INET, (const char*)rs, (const char*)s-1, &IP_LAST(ip).ipv4));
+					const uint32_t	first = ntohl(ip->ipv4.s_addr);
+					const uint32_t	last  = ntohl(IP_LAST(ip).ipv4.s_addr);
+					order = (first > last) - (first < last);
+				} else {
+					TEST_OK_LABEL(finally, code, parse_addr(interp, AF_INET6, str, (const char*)ae, &ip->ipv6));
+					TEST_OK_LABEL(finally, code, parse_addr(interp, AF_INET6, (const char*)rs, (const char*)s-1, &IP_LAST(ip).ipv6));
+					order = memcmp(ip->ipv6.s6_addr, IP_LAST(ip).ipv6.s6_addr, sizeof(ip->ipv6.s6_addr));
+				}
+				if (order > 0)
+					THROW_PRINTF_LABEL(finally, code, "Invalid range \"%s\": first address is after the last", str);
+				ip->netbits = -1;
+				break;
+			}
+			//>>>
+		case SPEC_WILDCARD: //<<<
+			{
+				// Only trailing octets can be wildcards, so it's just another way to spell a CIDR: 10.1.* is 10.1.0.0/16
+				uint8_t*	octets = (uint8_t*)&ip->ipv4;
+				const char*	p = str;
+				int			known = 0, wild = 0;
+
+				while (*p != '*') {
+					char*	e = NULL;
+					octets[known++] = (uint8_t)strtoul(p, &e, 10);
+					p = e + 1;	// Skip the "."
+				}
+				for (; *p; p++) if (*p == '*') wild++;
+
+				if (known + wild > 4)
+					THROW_PRINTF_LABEL(finally, code, "Can't parse IP \"%s\"", str);
+				ip->netbits = known * 8;
+				break;
+			}
+			//>>>
+	}
+
+	convert_v4mapped(ip);
+
+finally:
+	return code;
+}
+
+//>>>
 struct Tcl_ObjType networks_objtype;
 static int GetIPFromObj(Tcl_Interp* interp, Tcl_Obj* obj, struct ip_info** ipPtr) //<<<
 {
 	int					code = TCL_OK;
-	struct ip_info*		ip = NULL;
 	Tcl_ObjInternalRep*	ir = NULL;
 
 	ir = Tcl_FetchInternalRep(obj, &ip_objtype);
@@ -180,123 +482,27 @@ static int GetIPFromObj(Tcl_Interp* interp, Tcl_Obj* obj, struct ip_info** ipPtr
 	if (!ir) {
 		Tcl_ObjInternalRep*	net_ir = Tcl_FetchInternalRep(obj, &networks_objtype);
 		if (net_ir) {
-			Tcl_Size	count		= net_ir->ptrAndSize.size;
-			Tcl_Obj**	networks	= net_ir->ptrAndSize.ptr;
-			if (count == 1) {
+			struct networks_info*	info = net_ir->twoPtrValue.ptr1;
+			if (info->network) {
 				// We have a networks object with a single element, so we can
 				// just use that element as the IP object
-				ir = Tcl_FetchInternalRep(networks[0], &ip_objtype);
+				ir = Tcl_FetchInternalRep(info->network, &ip_objtype);
 			}
 		}
 	}
 
 	if (!ir) {
-		ip = ckalloc(sizeof(*ip));
-		*ip = (struct ip_info){0};
-
-		const unsigned char*	s = (const unsigned char*)Tcl_GetString(obj);
-		const unsigned char		*ns, *ae, *YYMARKER;
-		/*!stags:re2c format = "const unsigned char* @@;\n"; */
-		for (;;) {
-			/*!re2c
-				re2c:yyfill:enable		= 0;
-				re2c:define:YYCTYPE		= "unsigned char";
-				re2c:define:YYCURSOR	= "s";
-				re2c:flags:tags			= 1;
-
-				end			= [\x00];
-				digit		= [0-9];
-				hexdigit	= [0-9a-fA-F];
-				dec_octet
-					= digit
-					| [1-9] digit
-					| "1" digit{2}
-					| "2" [0-4] digit
-					| "25" [0-5];
-				ipv4address	= dec_octet "." dec_octet "." dec_octet "." dec_octet;
-				h16			= hexdigit{1,4};
-				ls32		= h16 ":" h16 | ipv4address;
-				ipv6address
-					=                            (h16 ":"){6} ls32
-					|                       "::" (h16 ":"){5} ls32
-					| (               h16)? "::" (h16 ":"){4} ls32
-					| ((h16 ":"){0,1} h16)? "::" (h16 ":"){3} ls32
-					| ((h16 ":"){0,2} h16)? "::" (h16 ":"){2} ls32
-					| ((h16 ":"){0,3} h16)? "::"  h16 ":"     ls32
-					| ((h16 ":"){0,4} h16)? "::"              ls32
-					| ((h16 ":"){0,5} h16)? "::"              h16
-					| ((h16 ":"){0,6} h16)? "::";
-				netbits		= "/" @ns digit{1,3};
-
-				ipv4address @ae netbits? end	{ ip->af = AF_INET;  break; }
-				ipv6address @ae netbits? end	{ ip->af = AF_INET6; break; }
-				* { THROW_PRINTF_LABEL(finally, code, "Can't parse IP \"%s\"", Tcl_GetString(obj)); }
-			*/
-		}
-
-		// Extract just the address part (without netbits) using the ae tag
-		char	ip_part[INET6_ADDRSTRLEN > INET_ADDRSTRLEN ? INET6_ADDRSTRLEN : INET_ADDRSTRLEN];
-		size_t	addr_len = ae - (const unsigned char*)Tcl_GetString(obj);
-
-		if (addr_len >= sizeof(ip_part))
-			THROW_ERROR_LABEL(finally, code, "IP address too long");
-
-		memcpy(ip_part, Tcl_GetString(obj), addr_len);
-		ip_part[addr_len] = '\0';
-
-		if (1 != inet_pton(ip->af, ip_part, ip->af == AF_INET ? &ip->ipv4 : (struct in_addr*)&ip->ipv6))
-			THROW_PRINTF_LABEL(finally, code, "inet_pton failed to parse \"%s\"", ip_part);
-
-		if (ns) {
-			const char*	netbits_str = (const char*)ns;
-			ip->netbits = (int)strtol(netbits_str, NULL, 10);
-
-			// Validate netbits range based on address family
-			if (ip->af == AF_INET) {
-				if (ip->netbits < 0 || ip->netbits > 32)
-					THROW_PRINTF_LABEL(finally, code, "Invalid netbits for IPv4: %d (must be 0-32)", ip->netbits);
-			} else if (ip->af == AF_INET6) {
-				if (ip->netbits < 0 || ip->netbits > 128)
-					THROW_PRINTF_LABEL(finally, code, "Invalid netbits for IPv6: %d (must be 0-128)", ip->netbits);
-			}
-		} else {
-			ip->netbits = ip->af == AF_INET ? 32 : 128; // Default to host bits
-		}
-
-		// Convert IPv4-in-IPv6 address to IPv4.  The alternative would be to convert all IPv4 addresses to IPv6
-		// which would simplify the later comparisons but would be less efficient for the IPv4 case, which is
-		// overwhelmingly more common.
-		if (
-				ip->af == AF_INET6 &&
-				ip->netbits >= 96 &&
-				*(uint64_t*)ip->ipv6.s6_addr == 0 &&
-				ip->ipv6.s6_addr[8] == 0 &&
-				ip->ipv6.s6_addr[9] == 0 &&
-				ip->ipv6.s6_addr[10] == 0xff &&
-				ip->ipv6.s6_addr[11] == 0xff
-		) {
-			memcpy(&ip->ipv4, &ip->ipv6.s6_addr[12], sizeof(ip->ipv4));
-			ip->af = AF_INET;
-			ip->netbits -= 96;
-		}
-
-		// Generate the sort keys
-		if (ip->af == AF_INET)
-			ip->skey = (uint32_t)ntohl(ip->ipv4.s_addr);
+		struct ip_range	parsed;
+		TEST_OK_LABEL(finally, code, parse_ip(interp, obj, 0, &parsed));
 
-		Tcl_StoreInternalRep(obj, &ip_objtype, &(Tcl_ObjInternalRep){.twoPtrValue.ptr1 = ip});
-		ip = NULL;	// transfer ownership to the obj intrep
-		register_intrep(obj);
+		// Share the ip_info with any other live object for the same network
+		set_ip_intrep(obj, intern_ip_info(&parsed.ip));
 		ir = Tcl_FetchInternalRep(obj, &ip_objtype);
 	}
 
 	*ipPtr = ir->twoPtrValue.ptr1;
 
 finally:
-	if (ip) {
-		ckfree(ip);
-		ip = NULL;
-	}
 	return code;
 }
 
@@ -305,144 +511,310 @@ finally:
 // networks_objtype <<<
 static void free_networks_internal_rep(Tcl_Obj* obj);
 static void dup_networks_internal_rep(Tcl_Obj* src, Tcl_Obj* dst);
-static void update_networks_string_rep(Tcl_Obj* obj);
 
+// The string rep is always generated before a networks intrep is stored (the
+// compiled intervals can't reproduce the list), so there is no updateStringProc
 struct Tcl_ObjType networks_objtype = {
 	.name				= "ip_networks",
 	.freeIntRepProc		= free_networks_internal_rep,
 	.dupIntRepProc		= dup_networks_internal_rep,
-	.updateStringProc	= update_networks_string_rep
 };
 
+static void free_networks_info(struct networks_info* info) //<<<
+{
+	if (info) {
+		replace_tclobj(&info->network, NULL);
+		if (info->v4) {
+			ckfree(info->v4);
+			info->v4 = NULL;
+		}
+		if (info->v6) {
+			ckfree(info->v6);
+			info->v6 = NULL;
+		}
+		ckfree(info);
+		info = NULL;
+	}
+}
+
+//>>>
 static void free_networks_internal_rep(Tcl_Obj* obj) //<<<
 {
 	Tcl_ObjInternalRep*	ir = Tcl_FetchInternalRep(obj, &networks_objtype);
-	Tcl_Obj**			networks	= ir->ptrAndSize.ptr;
-	Tcl_Size			count		= ir->ptrAndSize.size;
-
-#if 1
-	for (Tcl_Size i=0; i<count; i++) {
-		//if (i > 10) break;
-		replace_tclobj(&networks[i], NULL);
-	}
-#endif
 
 	forget_intrep(obj);
-	if (networks) {
-		ckfree(networks);
-		networks = NULL;
-	}
+	free_networks_info(ir->twoPtrValue.ptr1);
 }
 
 //>>>
 static void dup_networks_internal_rep(Tcl_Obj* src, Tcl_Obj* dst) //<<<
 {
-	Tcl_ObjInternalRep*	ir = Tcl_FetchInternalRep(src, &networks_objtype);
-	Tcl_Size			count		= ir->ptrAndSize.size;
-	Tcl_Obj**			networks	= ir->ptrAndSize.ptr;
-
-	// Create a copy of the networks array
-	Tcl_Obj** new_networks = ckalloc(count * sizeof(Tcl_Obj*));
-	memset(new_networks, 0, count * sizeof(Tcl_Obj*));
-	for (Tcl_Size i=0; i<count; i++)
-		replace_tclobj(&new_networks[i], networks[i]);
+	Tcl_ObjInternalRep*		ir = Tcl_FetchInternalRep(src, &networks_objtype);
+	struct networks_info*	info = ir->twoPtrValue.ptr1;
+	struct networks_info*	new_info = ckalloc(sizeof(*new_info));
+
+	*new_info = *info;
+	new_info->network = NULL;
+	replace_tclobj(&new_info->network, info->network);
+
+	// Copy the compiled intervals
+	if (info->v4) {
+		new_info->v4 = ckalloc(info->count4 * sizeof(struct interval4));
+		memcpy(new_info->v4, info->v4, info->count4 * sizeof(struct interval4));
+	}
+	if (info->v6) {
+		new_info->v6 = ckalloc(info->count6 * sizeof(struct interval6));
+		memcpy(new_info->v6, info->v6, info->count6 * sizeof(struct interval6));
+	}
 
 	// Store the new internal rep in the destination object
-	Tcl_StoreInternalRep(dst, &networks_objtype, &(Tcl_ObjInternalRep){
-			.ptrAndSize.ptr		= new_networks,
-			.ptrAndSize.size	= count
-	});
+	Tcl_StoreInternalRep(dst, &networks_objtype, &(Tcl_ObjInternalRep){.twoPtrValue.ptr1 = new_info});
 	register_intrep(dst); // Register the new object in the intrep table
 }
 
 //>>>
-static void update_networks_string_rep(Tcl_Obj* obj) //<<<
+
+static uint32_t netmask4(int netbits) //<<<
 {
-	Tcl_ObjInternalRep*	ir = Tcl_FetchInternalRep(obj, &networks_objtype);
-	Tcl_Obj**			networks	= ir->ptrAndSize.ptr;
-	Tcl_Size			count		= ir->ptrAndSize.size;
-	Tcl_DString			ds;
+	if (netbits < 0 || netbits > 32) Tcl_Panic("Invalid netbits: %d", netbits);
+	return (uint32_t)(~0UL << (32 - netbits));
+}
 
-	Tcl_DStringInit(&ds);
+//>>>
+static struct interval4 interval4(const struct ip_info* ip) //<<<
+{
+	if (ip->netbits < 0)
+		return (struct interval4){.lo = ntohl(ip->ipv4.s_addr), .hi = ntohl(IP_LAST(ip).ipv4.s_addr)};
 
-	// Create a string representation of the networks: A Tcl list of IP objects
-	for (Tcl_Size i=0; i<count; i++)
-		Tcl_DStringAppendElement(&ds, Tcl_GetString(networks[i]));
+	const uint32_t	mask = netmask4(ip->netbits);
+	const uint32_t	lo = ntohl(ip->ipv4.s_addr) & mask;
+	return (struct interval4){.lo = lo, .hi = lo | ~mask};
+}
 
-	Tcl_InitStringRep(obj, Tcl_DStringValue(&ds), Tcl_DStringLength(&ds));
-	Tcl_DStringFree(&ds);
+//>>>
+static struct interval6 interval6(const struct ip_info* ip) //<<<
+{
+	struct interval6	res;
+
+	if (ip->netbits < 0) {
+		memcpy(res.lo, ip->ipv6.s6_addr,      sizeof(res.lo));
+		memcpy(res.hi, IP_LAST(ip).ipv6.s6_addr, sizeof(res.hi));
+		return res;
+	}
+
+	if (ip->netbits > 128) Tcl_Panic("Invalid netbits: %d", ip->netbits);
+	for (int i=0; i<16; i++) {
+		const int		bits = ip->netbits - i*8;
+		const uint8_t	mask = bits >= 8 ? 0xff : bits <= 0 ? 0 : (uint8_t)(0xff << (8 - bits));
+		res.lo[i] = ip->ipv6.s6_addr[i] & mask;
+		res.hi[i] = res.lo[i] | (uint8_t)~mask;
+	}
+	return res;
 }
 
 //>>>
+static int compare_interval4(const void* a, const void* b) //<<<
+{
+	const uint32_t	lo_a = ((const struct interval4*)a)->lo;
+	const uint32_t	lo_b = ((const struct interval4*)b)->lo;
+	return (lo_a > lo_b) - (lo_a < lo_b);
+}
 
-static uint32_t netmask4(int netbits) //<<<
+//>>>
+static int compare_interval6(const void* a, const void* b) //<<<
 {
-	if (netbits < 0 || netbits > 32) Tcl_Panic("Invalid netbits: %d", netbits);
-	return (uint32_t)(~0UL << (32 - netbits));
+	return memcmp(((const struct interval6*)a)->lo, ((const struct interval6*)b)->lo, 16);
 }
 
 //>>>
-static int64_t cmp_network4(const struct ip_info* addr, const struct ip_info* net) //<<<
+static int abuts6(const uint8_t hi[16], const uint8_t lo[16]) //<<<
 {
-	const int16_t	netbits = net->netbits;
-	const uint32_t	mask = netmask4(netbits);
-	if ((addr->skey & mask) == (net->skey & mask)) return 0;
-	return addr->skey - net->skey;
+	// True if lo is the address immediately after hi
+	uint8_t	next[16];
+	int		i;
+
+	memcpy(next, hi, sizeof(next));
+	for (i=15; i>=0; i--)
+		if (++next[i] != 0) break;
+	if (i < 0) return 0;	// hi was the last address, wrapped
+
+	return memcmp(next, lo, sizeof(next)) == 0;
 }
 
 //>>>
-static int64_t cmp_network6(const struct ip_info* addr, const struct ip_info* net) //<<<
+static int mapped_part4(const struct interval6* iv, struct interval4* res) //<<<
 {
-	const uint16_t	netbits = net->netbits;
-	if (netbits < 0 || netbits > 128) Tcl_Panic("Invalid netbits: %d", netbits);
+	// IPv6 networks and ranges entirely within ::ffff:0:0/96 were converted to IPv4 when parsed,
+	// but one that only partly covers it (::/64, ::/0, a range crossing its boundary) stays IPv6.
+	// IPv4-mapped addresses are always searched for as IPv4, so return the overlap (if any) as
+	// an IPv4 interval to go in the v4 table too
+	static const uint8_t	first[16] = {[10] = 0xff, [11] = 0xff};
+	static const uint8_t	last[16]  = {[10] = 0xff, [11] = 0xff, [12] = 0xff, [13] = 0xff, [14] = 0xff, [15] = 0xff};
+	uint32_t				addr;
 
-	int i;
-	for (i=0; i<netbits/8; i++) {
-		const int diff = net->ipv6.s6_addr[i] - addr->ipv6.s6_addr[i];
-		if (diff != 0) return diff;
+	if (
+			memcmp(iv->hi, first, 16) < 0 ||
+			memcmp(iv->lo, last,  16) > 0
+	) return 0;
+
+	if (memcmp(iv->lo, first, 16) < 0) {
+		res->lo = 0;
+	} else {
+		memcpy(&addr, &iv->lo[12], sizeof(addr));
+		res->lo = ntohl(addr);
 	}
 
-	if (netbits % 8) {
-		const uint8_t mask = (uint8_t)(~0U << (8 - netbits % 8));
-		const int diff = (addr->ipv6.s6_addr[i] & mask) - (net->ipv6.s6_addr[i] & mask);
-		return diff;
+	if (memcmp(iv->hi, last, 16) > 0) {
+		res->hi = UINT32_MAX;
+	} else {
+		memcpy(&addr, &iv->hi[12], sizeof(addr));
+		res->hi = ntohl(addr);
 	}
 
-	return 0;
+	return 1;
+}
+
+//>>>
+static void add_interval4(struct networks_info* info, Tcl_Size* size, struct interval4 iv) //<<<
+{
+	if (info->count4 == *size) {
+		*size = *size ? *size * 2 : 8;
+		info->v4 = ckrealloc(info->v4, *size * sizeof(struct interval4));
+	}
+	info->v4[info->count4++] = iv;
+}
+
+//>>>
+static void add_interval6(struct networks_info* info, Tcl_Size* size, struct interval6 iv) //<<<
+{
+	if (info->count6 == *size) {
+		*size = *size ? *size * 2 : 8;
+		info->v6 = ckrealloc(info->v6, *size * sizeof(struct interval6));
+	}
+	info->v6[info->count6++] = iv;
 }
 
 //>>>
-static int64_t _compare_ip(Tcl_Obj* ip1Obj, Tcl_Obj* ip2Obj) //<<<
+static int compile_networks(Tcl_Interp* interp, Tcl_Size count, Tcl_Obj*const* networks, struct networks_info** infoPtr) //<<<
 {
-	struct ip_info*	ip1 = NULL;
-	struct ip_info*	ip2 = NULL;
+	// Only the compiled intervals are kept, the caller still owns networks.  Elements
+	// that aren't IP objects already are parsed straight into their intervals: giving
+	// each one an interned ip_info and an intrep would cost more than the whole
+	// compiled list for as long as the source list lives
+	int						code = TCL_OK;
+	struct networks_info*	info = ckalloc(sizeof(*info));
+	Tcl_Size				size4 = 0, size6 = 0, n;
+
+	*info = (struct networks_info){0};
+
+	if (count == 1) {
+		// Keep the element so the networks object can still be used as an address, if it is one
+		struct ip_info*	ip = NULL;
+		if (TCL_OK == GetIPFromObj(interp, networks[0], &ip))
+			replace_tclobj(&info->network, networks[0]);
+		else
+			Tcl_ResetResult(interp);	// A range or wildcard (or invalid, which is reported below)
+	}
+
+	for (Tcl_Size i=0; i<count; i++) {
+		Tcl_ObjInternalRep*		ir = Tcl_FetchInternalRep(networks[i], &ip_objtype);
+		struct ip_range			parsed;
+		const struct ip_info*	ip = NULL;
+		struct interval4		mapped;
+
+		if (ir) {
+			ip = ir->twoPtrValue.ptr1;
+		} else {
+			TEST_OK_LABEL(finally, code, parse_ip(interp, networks[i], 1, &parsed));
+			ip = &parsed.ip;
+		}
+
+		if (ip->af == AF_INET) {
+			add_interval4(info, &size4, interval4(ip));
+		} else {
+			const struct interval6	iv = interval6(ip);
+			add_interval6(info, &size6, iv);
+			if (mapped_part4(&iv, &mapped))
+				add_interval4(info, &size4, mapped);
+		}
+	}
+
+	// Sort by first address and merge overlapping and adjacent intervals
+	if (info->count4 > 1) {
+		qsort(info->v4, info->count4, sizeof(struct interval4), compare_interval4);
+		n = 0;
+		for (Tcl_Size i=1; i<info->count4; i++) {
+			struct interval4*	cur = &info->v4[n];
+			if ((uint64_t)info->v4[i].lo <= (uint64_t)cur->hi + 1) {
+				if (info->v4[i].hi > cur->hi) cur->hi = info->v4[i].hi;
+			} else {
+				info->v4[++n] = info->v4[i];
+			}
+		}
+		info->count4 = n+1;
+	}
+	if (info->count6 > 1) {
+		qsort(info->v6, info->count6, sizeof(struct interval6), compare_interval6);
+		n = 0;
+		for (Tcl_Size i=1; i<info->count6; i++) {
+			struct interval6*	cur = &info->v6[n];
+			if (memcmp(info->v6[i].lo, cur->hi, 16) <= 0 || abuts6(cur->hi, info->v6[i].lo)) {
+				if (memcmp(info->v6[i].hi, cur->hi, 16) > 0) memcpy(cur->hi, info->v6[i].hi, 16);
+			} else {
+				info->v6[++n] = info->v6[i];
+			}
+		}
+		info->count6 = n+1;
+	}
 
-	if (TCL_OK != GetIPFromObj(NULL, ip1Obj, &ip1)) Tcl_Panic("compare_ip: ip1 isn't valid: \"%s\"", Tcl_GetString(ip1Obj));
-	if (TCL_OK != GetIPFromObj(NULL, ip2Obj, &ip2)) Tcl_Panic("compare_ip: ip2 isn't valid: \"%s\"", Tcl_GetString(ip2Obj));
+	// Give back what the merge freed up
+	if (info->count4 < size4) info->v4 = ckrealloc(info->v4, info->count4 * sizeof(struct interval4));
+	if (info->count6 < size6) info->v6 = ckrealloc(info->v6, info->count6 * sizeof(struct interval6));
 
-	if (ip1->af != ip2->af)
-		return ip1->af == AF_INET ? -1 : 1;	// Sort all IPv4 addresses before IPv6 addresses
+	*infoPtr = info;
+	info = NULL;
 
-	// return 0 (equal) if ip1 is within ip2 (considering the netbits of ip2)
-	return ip1->af == AF_INET ?
-			cmp_network4(ip1, ip2) :
-			cmp_network6(ip1, ip2);
+finally:
+	if (info) {
+		free_networks_info(info);
+		info = NULL;
+	}
+	return code;
 }
 
 //>>>
-static int compare_ip(const void* a, const void* b) //<<<
+static int networks_contain(const struct networks_info* info, const struct ip_info* ip) //<<<
 {
-	const int64_t res = _compare_ip(*(Tcl_Obj**)a, *(Tcl_Obj**)b);
-	return res < 0 ? -1 : res > 0 ? 1 : 0;		// res could be outside of the range of int (ie. 0 - (2**32-1) or the other way around), so we need to normalize to {-1, 0, 1}
+	// An address or network is contained if its address (as given, ignoring its own netbits) is
+	// within one of the networks.
+	// Binary search for the last interval starting at or before the address
+	Tcl_Size	l = 0, r;
+
+	if (ip->af == AF_INET) {
+		const uint32_t	want = ntohl(ip->ipv4.s_addr);
+		r = info->count4;
+		while (l < r) {
+			const Tcl_Size	m = l + (r-l)/2;
+			if (info->v4[m].lo <= want) l = m+1; else r = m;
+		}
+		return l > 0 && want <= info->v4[l-1].hi;
+	} else {
+		const uint8_t*	want = ip->ipv6.s6_addr;
+		r = info->count6;
+		while (l < r) {
+			const Tcl_Size	m = l + (r-l)/2;
+			if (memcmp(info->v6[m].lo, want, 16) <= 0) l = m+1; else r = m;
+		}
+		return l > 0 && memcmp(want, info->v6[l-1].hi, 16) <= 0;
+	}
 }
 
 //>>>
-static int GetNetworksFromObj(Tcl_Interp* interp, Tcl_Obj* obj, Tcl_Size* count, Tcl_Obj*** networksPtr) //<<<
+static int GetNetworksFromObj(Tcl_Interp* interp, Tcl_Obj* obj, struct networks_info** infoPtr) //<<<
 {
 	int					code = TCL_OK;
-	Tcl_Obj**			networks = NULL;
+	Tcl_Obj*			dup = NULL;
 	Tcl_ObjInternalRep*	ir = NULL;
-	Tcl_Size			oc = 0;
 
 	ir = Tcl_FetchInternalRep(obj, &networks_objtype);
 
@@ -450,68 +822,98 @@ static int GetNetworksFromObj(Tcl_Interp* interp, Tcl_Obj* obj, Tcl_Size* count,
 		Tcl_ObjInternalRep*	ip_ir = Tcl_FetchInternalRep(obj, &ip_objtype);
 		if (ip_ir) {
 			// We have an IP object, so we need to upconvert it to a networks object of one element (a duplicate of the IP object to avoid a circular reference)
-			networks = ckalloc(sizeof(Tcl_Obj*));
-			memset(networks, 0, sizeof(Tcl_Obj*));
-			replace_tclobj(&networks[0], Tcl_DuplicateObj(obj));
-			oc = 1;
+			struct networks_info*	info = NULL;
+
+			Tcl_GetString(obj);
+			replace_tclobj(&dup, Tcl_DuplicateObj(obj));
+			TEST_OK_LABEL(finally, code, compile_networks(interp, 1, &dup, &info));
 			Tcl_StoreInternalRep(obj, &networks_objtype, &(Tcl_ObjInternalRep){
-					.ptrAndSize.ptr		= networks,
-					.ptrAndSize.size	= oc
+					.twoPtrValue.ptr1	= info
 			});
 			register_intrep(obj);
 			ir = Tcl_FetchInternalRep(obj, &networks_objtype);
-			networks = NULL;	// transfer ownership to the obj intrep
 		}
 	}
 
 	if (!ir) {
 		// networks stringrep is a Tcl list of ip objects
-		Tcl_Obj**	ov = NULL;
-		TEST_OK_LABEL(finally, code, Tcl_ListObjGetElements(interp, obj, &oc, &ov));
-
-		if (oc > 0) {
-			networks = ckalloc(oc * sizeof(Tcl_Obj*));
-			memset(networks, 0, oc * sizeof(Tcl_Obj*));
+		Tcl_Obj**				ov = NULL;
+		Tcl_Size				oc = 0;
+		struct networks_info*	info = NULL;
 
-			for (Tcl_Size i=0; i<oc; i++) {
-				struct ip_info*	ip = NULL;
-				TEST_OK_LABEL(finally, code, GetIPFromObj(interp, ov[i], &ip));	// Ensure all the list elements are valid IPs
-				replace_tclobj(&networks[i], ov[i]);
-			}
+		Tcl_GetString(obj);
+		TEST_OK_LABEL(finally, code, Tcl_ListObjGetElements(interp, obj, &oc, &ov));
 
-			// Sort the networks by address family and address
-			if (oc > 1)
-				qsort(networks, oc, sizeof(Tcl_Obj*), compare_ip);
-		}
+		// Compile before replacing the list intrep, which owns ov.  Duplicate
+		// entries (however they're spelled) merge into the same interval
+		TEST_OK_LABEL(finally, code, compile_networks(interp, oc, ov, &info));
 		Tcl_StoreInternalRep(obj, &networks_objtype, &(Tcl_ObjInternalRep){
-				.ptrAndSize.ptr		= networks,
-				.ptrAndSize.size	= oc
+				.twoPtrValue.ptr1	= info
 		});
-
-		networks = NULL;	// transfer ownership to the obj intrep
 		register_intrep(obj);
 		ir = Tcl_FetchInternalRep(obj, &networks_objtype);
 	}
 
-	*networksPtr	= ir->ptrAndSize.ptr;
-	*count			= ir->ptrAndSize.size;
+	*infoPtr = ir->twoPtrValue.ptr1;
 
 finally:
-	if (networks) {
-		for (Tcl_Size i=0; i<oc; i++) replace_tclobj(&networks[i], NULL);
-		ckfree(networks);
-		networks = NULL;
-	}
+	replace_tclobj(&dup, NULL);
 	return code;
 }
 
 //>>>
 // networks_objtype >>>
 
+static int get_mask_bits(Tcl_Interp* interp, const struct ip_info* ip, const int* bits4, const int* bits6, int* bitsPtr) //<<<
+{
+	// bits4 and bits6 are NULL if not supplied.  IPv4-mapped IPv6 addresses are IPv4 by now, so take bits4
+	int			code = TCL_OK;
+	const int*	bits = ip->af == AF_INET6 && bits6 ? bits6 : bits4;
+
+	if (!bits) {
+		*bitsPtr = ip->netbits;
+	} else {
+		if (ip->af == AF_INET) {
+			if (*bits < 0 || *bits > 32)
+				THROW_PRINTF_LABEL(finally, code, "Invalid netbits for IPv4: %d (must be 0-32)", *bits);
+		} else {
+			if (*bits < 0 || *bits > 128)
+				THROW_PRINTF_LABEL(finally, code, "Invalid netbits for IPv6: %d (must be 0-128)", *bits);
+		}
+
+		// Masking a network to more bits than it has would invent a host part rather than give the network containing it
+		*bitsPtr = *bits > ip->netbits ? ip->netbits : *bits;
+	}
+
+finally:
+	return code;
+}
+
+//>>>
+static struct ip_info mask_ip_info(const struct ip_info* ip, int netbits) //<<<
+{
+	// Return a copy of ip as the network of netbits containing it
+	struct ip_info	res = *ip;
+
+	res.netbits = netbits;
+	if (res.af == AF_INET) {
+		const struct interval4	iv = interval4(&res);
+		res.ipv4.s_addr	= htonl(iv.lo);
+	} else {
+		const struct interval6	iv = interval6(&res);
+		memcpy(res.ipv6.s6_addr, iv.lo, sizeof(res.ipv6.s6_addr));
+	}
+	convert_v4mapped(&res);		// Keep the same canonical form GetIPFromObj produces
+	return res;
+}
+
+//>>>
+
 INIT { //<<<
 	ll_intreps_head.next = &ll_intreps_tail;
 	ll_intreps_tail.prev = &ll_intreps_head;
 	Tcl_InitHashTable(&g_intreps, TCL_ONE_WORD_KEYS);
+	Tcl_InitCustomHashTable(&g_ip_intern, TCL_CUSTOM_TYPE_KEYS, &ip_info_keytype);
 	for (int i=0; i<L_size; i++) replace_tclobj(&lit[i], Tcl_NewStringObj(lit_str[i], -1));
 	return TCL_OK;
 }
@@ -537,6 +939,10 @@ RELEASE { //<<<
 			ll_intreps_tail.prev != &ll_intreps_head
 	) Tcl_Panic("ll_intreps_head->next != ll_intreps_tail");
 
+	// All the ip_objtype intreps are gone, so the last references to the interned ip_infos have been released
+	if (g_ip_intern.numEntries) Tcl_Panic("interned ip_infos outlived their intreps");
+
+	Tcl_DeleteHashTable(&g_ip_intern);
 	Tcl_DeleteHashTable(&g_intreps);
 }
 
@@ -551,6 +957,8 @@ OBJCMD(ip) //<<<
 		"eq",
 		"contained",
 		"lookup",
+		"mask",
+		"key",
 		NULL
 	};
 	enum {
@@ -560,6 +968,8 @@ OBJCMD(ip) //<<<
 		OP_EQ,
 		OP_CONTAINED,
 		OP_LOOKUP,
+		OP_MASK,
+		OP_KEY,
 	} op;
 	Tcl_Obj*	tmp = NULL;
 	Tcl_Obj*	res = NULL;
@@ -594,14 +1004,14 @@ OBJCMD(ip) //<<<
 				// Validate the IP format by retrieving its internal representation
 				TEST_OK_LABEL(finally, code, GetIPFromObj(interp, objv[A_IP], &ip));
 
-				Tcl_Obj*	res = NULL;
-				if (Tcl_HasStringRep(objv[A_IP]) && !ip->normalized) {
-					res = Tcl_DuplicateObj(objv[A_IP]);	// Create a duplicate that we can manipulate
-					Tcl_InvalidateStringRep(res);		// Invalidate the string representation to force regeneration
+				// The normalized flag lives on the object rather than the shared ip_info, and objv[A_IP]
+				// might be a single element networks object rather than an ip_objtype
+				Tcl_ObjInternalRep*	ir = Tcl_FetchInternalRep(objv[A_IP], &ip_objtype);
+				if (ir && (!Tcl_HasStringRep(objv[A_IP]) || ir->twoPtrValue.ptr2)) {
+					Tcl_SetObjResult(interp, objv[A_IP]);
 				} else {
-					res = objv[A_IP];
+					Tcl_SetObjResult(interp, new_ip_obj(ip));
 				}
-				Tcl_SetObjResult(interp, res);
 				break;
 			}
 			//>>>
@@ -624,15 +1034,8 @@ OBJCMD(ip) //<<<
 				struct ip_info*	ip2 = NULL;
 				TEST_OK_LABEL(finally, code, GetIPFromObj(interp, objv[A_IP1], &ip1));
 				TEST_OK_LABEL(finally, code, GetIPFromObj(interp, objv[A_IP2], &ip2));
-				Tcl_SetObjResult(interp, lit[
-						ip1->af			== ip2->af &&
-						ip1->netbits	== ip2->netbits &&
-						(
-							(ip1->af == AF_INET  && ip1->ipv4.s_addr == ip2->ipv4.s_addr) ||
-							(ip1->af == AF_INET6 && memcmp(&ip1->ipv6.s6_addr, &ip2->ipv6.s6_addr, sizeof(ip1->ipv6.s6_addr)) == 0)
-						)
-						? L_TRUE : L_FALSE
-				]);
+				// ip_infos are interned on (af, address, netbits), so equal addresses share one
+				Tcl_SetObjResult(interp, lit[ip1 == ip2 ? L_TRUE : L_FALSE]);
 				break;
 			}
 			//>>>
@@ -640,44 +1043,40 @@ OBJCMD(ip) //<<<
 			{
 				enum {A_cmd=1, A_NETWORKS, A_IP, A_objc};
 				CHECK_ARGS_LABEL(finally, code, "networks ip");
-				Tcl_Obj**			networks = NULL;
-				Tcl_Size			count = 0;
-				struct ip_info*		ip = NULL;
+				struct networks_info*	info = NULL;
+				struct ip_info*			ip = NULL;
 
 				// Must get the networks intrep first, since A_NETWORKS and A_IP may alias each other
 				// and GetNetworksFromObj will shimmer an ip_objtype to networks_objtype, invalidating
 				// the ip_objtype intrep pointer we would be holding if we'd fetched that one first.
-				TEST_OK_LABEL(finally, code, GetNetworksFromObj(interp, objv[A_NETWORKS], &count, &networks));
-				TEST_OK_LABEL(finally, code, GetIPFromObj(interp, objv[A_IP], &ip));	// Not directly required, but rather do it here where proper errors can be thrown, rather than Tcl_Panicing in _compare_ip
+				TEST_OK_LABEL(finally, code, GetNetworksFromObj(interp, objv[A_NETWORKS], &info));
+				TEST_OK_LABEL(finally, code, GetIPFromObj(interp, objv[A_IP], &ip));
 
-				// Perform binary search
-				Tcl_Obj* result = bsearch(&objv[A_IP], networks, count, sizeof(Tcl_Obj*), compare_ip);
-				
-				Tcl_SetObjResult(interp, lit[result != NULL ? L_TRUE : L_FALSE]);
+				Tcl_SetObjResult(interp, lit[networks_contain(info, ip) ? L_TRUE : L_FALSE]);
 				break;
 			}
 			//>>>
 			case OP_LOOKUP: //<<<
 			{
-				Tcl_Obj**			networks = NULL;
-				Tcl_Size			count = 0;
-				struct ip_info*		ip = NULL;
-				Tcl_DictSearch		search;
-				Tcl_Obj				*k, *v;
-				int					done;
+				struct networks_info*	info = NULL;
+				struct ip_info*			ip = NULL;
+				Tcl_DictSearch			search;
+				Tcl_Obj					*k, *v;
+				int						done;
 
 				enum {A_cmd=1, A_NETWORK_SETS, A_IP, A_objc};
 				CHECK_ARGS_LABEL(finally, code, "network_sets ip");
 
-				TEST_OK_LABEL(finally, code, GetIPFromObj(interp, objv[A_IP], &ip));	// Not directly required, but rather do it here where proper errors can be thrown, rather than Tcl_Panicing in _compare_ip
+				TEST_OK_LABEL(finally, code, GetIPFromObj(interp, objv[A_IP], &ip));	// Validate before walking the sets, so a bad address is reported even if network_sets is empty
 				ip = NULL;	// Could be invalidated by later GetNetworksFromObj
 
 				replace_tclobj(&res, Tcl_NewListObj(0, NULL));
 				TEST_OK_LABEL(finally, code, Tcl_DictObjFirst(interp, objv[A_NETWORK_SETS], &search, &k, &v, &done));
 				for (; !done; Tcl_DictObjNext(&search, &k, &v, &done)) {
 					replace_tclobj(&tmp, v);
-					TEST_OK_LABEL(donesearch, code, GetNetworksFromObj(interp, tmp, &count, &networks));
-					if (NULL != bsearch(&objv[A_IP], networks, count, sizeof(Tcl_Obj*), compare_ip))
+					TEST_OK_LABEL(donesearch, code, GetNetworksFromObj(interp, tmp, &info));
+					TEST_OK_LABEL(donesearch, code, GetIPFromObj(interp, objv[A_IP], &ip));	// Already parsed, just refetch the intrep
+					if (networks_contain(info, ip))
 						TEST_OK_LABEL(donesearch, code, Tcl_ListObjAppendElement(interp, res, k));
 				}
 			donesearch:
@@ -688,6 +1087,71 @@ OBJCMD(ip) //<<<
 				break;
 			}
 
+			//>>>
+		case OP_MASK: //<<<
+			{
+				enum {A_cmd=1, A_IP, A_BITS, A_BITS6, A_objc};
+				struct ip_info*	ip = NULL;
+				int				bits4, bits6, bits;
+
+				if (objc < A_BITS6 || objc > A_objc) {
+					Tcl_WrongNumArgs(interp, A_cmd+1, objv, "address bits ?bits6?");
+					code = TCL_ERROR;
+					goto finally;
+				}
+
+				// Get the ints before the ip intrep, in case they alias
+				TEST_OK_LABEL(finally, code, Tcl_GetIntFromObj(interp, objv[A_BITS], &bits4));
+				if (objc > A_BITS6) TEST_OK_LABEL(finally, code, Tcl_GetIntFromObj(interp, objv[A_BITS6], &bits6));
+				TEST_OK_LABEL(finally, code, GetIPFromObj(interp, objv[A_IP], &ip));
+				TEST_OK_LABEL(finally, code, get_mask_bits(interp, ip,
+							objc > A_BITS  ? &bits4 : NULL,
+							objc > A_BITS6 ? &bits6 : NULL,
+							&bits));
+
+				// Straight from the parsed ip_info to an (interned) ip_objtype, no string rep until it's needed
+				const struct ip_info	masked = mask_ip_info(ip, bits);
+				Tcl_SetObjResult(interp, new_ip_obj(intern_ip_info(&masked)));
+				break;
+			}
+			//>>>
+		case OP_KEY: //<<<
+			{
+				enum {A_cmd=1, A_IP, A_BITS, A_BITS6, A_objc};
+				struct ip_info*	ip = NULL;
+				int				bits4, bits6, bits;
+
+				if (objc < A_BITS || objc > A_objc) {
+					Tcl_WrongNumArgs(interp, A_cmd+1, objv, "address ?bits? ?bits6?");
+					code = TCL_ERROR;
+					goto finally;
+				}
+
+				// Get the ints before the ip intrep, in case they alias
+				if (objc > A_BITS)  TEST_OK_LABEL(finally, code, Tcl_GetIntFromObj(interp, objv[A_BITS],  &bits4));
+				if (objc > A_BITS6) TEST_OK_LABEL(finally, code, Tcl_GetIntFromObj(interp, objv[A_BITS6], &bits6));
+				TEST_OK_LABEL(finally, code, GetIPFromObj(interp, objv[A_IP], &ip));
+				TEST_OK_LABEL(finally, code, get_mask_bits(interp, ip,
+							objc > A_BITS  ? &bits4 : NULL,
+							objc > A_BITS6 ? &bits6 : NULL,
+							&bits));
+
+				// An integer where it fits, which is cheap to hash as a dict or array key: the address
+				// (IPv4) or its first 56 bits (IPv6), then a byte with the netbits, with the top bit of
+				// that byte set for IPv6 so the families can't collide.  Longer IPv6 networks don't fit,
+				// so they are keyed by the network itself, as ip mask returns it
+				const struct ip_info	masked = mask_ip_info(ip, bits);
+				if (masked.af == AF_INET) {
+					Tcl_SetObjResult(interp, Tcl_NewWideIntObj((Tcl_WideInt)ntohl(masked.ipv4.s_addr) << 8 | masked.netbits));
+				} else if (masked.netbits <= 56) {
+					uint64_t	key = 0;
+					for (int i=0; i<7; i++) key = key << 8 | masked.ipv6.s6_addr[i];
+					Tcl_SetObjResult(interp, Tcl_NewWideIntObj((Tcl_WideInt)(key << 8 | 0x80 | masked.netbits)));
+				} else {
+					Tcl_SetObjResult(interp, new_ip_obj(intern_ip_info(&masked)));
+				}
+				break;
+			}
 			//>>>
 		default: THROW_ERROR_LABEL(finally, code, "Unhandled op");
 	}
@@ -120,6 +120,75 @@ namespace eval ::ip::test {
 		ip contained 10.0.0.0/8 ::ffff::10.0.1.1
 	} -returnCodes error -result {Can't parse IP "::ffff::10.0.1.1"}
 
+	# Interning: duplicate networks share one parsed ip_info
+	test intern-eq-spellings		"Test eq across spellings of the same address"	{ip eq 2001:0db8:0:0::1 2001:db8::1}	1
+	test intern-eq-netbits			"Test eq distinguishes netbits"					{ip eq 10.0.0.0/8 10.0.0.0/16}			0
+	test intern-normalize-shared	"Test normalize of a spelling sharing an interned ip_info" -body {
+		list [ip normalize [string cat 2001:db8::1]] [ip normalize [string cat 2001:0db8::0001]]
+	} -result {2001:db8::1 2001:db8::1}
+	test intern-duplicate-networks	"Test networks list with duplicate entries" -body {
+		set networks	[string cat {2001:db8::/64 10.0.0.0/8 2001:0db8:0::/64 10.0.0.0/8}]
+		list [ip contained $networks 10.1.2.3] [ip contained $networks 2001:db8::5] [ip contained $networks 11.0.0.1] $networks
+	} -cleanup {unset -nocomplain networks} -result {1 1 0 {2001:db8::/64 10.0.0.0/8 2001:0db8:0::/64 10.0.0.0/8}}
+	test intern-networks-pure-list	"Test a pure list keeps its string rep when compiled" -body {
+		set networks	[list 10.0.0.0/8 2001:0db8::/64 10.0.0.0/8]
+		list [ip contained $networks 10.1.2.3] [ip contained $networks 2001:db8::5] $networks
+	} -cleanup {unset -nocomplain networks} -result {1 1 {10.0.0.0/8 2001:0db8::/64 10.0.0.0/8}}
+	test intern-duplicate-not-ip	"Test a list of duplicates isn't accepted as a single address" -body {
+		set networks	[string cat {10.0.0.0/8 10.0.0.0/8}]
+		list [ip contained $networks 10.1.2.3] [ip valid $networks]
+	} -cleanup {unset -nocomplain networks} -result {1 0}
+
+	# Ranges and wildcards (networks lists only)
+	test range-ipv4mapped			"Test an IPv4-mapped range"					{ip contained {::ffff:10.0.0.1-::ffff:10.0.0.9} 10.0.0.5}	1
+	test range-reversed				"Test a range ending before it starts" -body {
+		ip contained {10.0.0.9-10.0.0.1} 10.0.0.5
+	} -returnCodes error -result {Invalid range "10.0.0.9-10.0.0.1": first address is after the last}
+	test range-mixed				"Test a range mixing IPv4 and IPv6" -body {
+		ip contained {10.0.0.1-2001:db8::1} 10.0.0.5
+	} -returnCodes error -result {Can't parse IP "10.0.0.1-2001:db8::1"}
+	test wildcard-too-long			"Test a wildcard with too many octets" -body {
+		ip contained {10.1.2.3.*} 10.0.0.5
+	} -returnCodes error -result {Can't parse IP "10.1.2.3.*"}
+	test range-not-address			"Test ranges and wildcards aren't addresses" -body {
+		lmap a {* 10.* 192.168.*.* 1.2.3.4-5.6.7.8 2001:db8::10-2001:db8::1:0} {ip valid $a}
+	} -result {0 0 0 0 0}
+	test range-not-address-networks	"Test a single range or wildcard networks list isn't an address" -body {
+		set networks	[string cat 10.*]
+		list [ip contained $networks 10.1.2.3] [ip valid $networks]
+	} -cleanup {unset -nocomplain networks} -result {1 0}
+	test range-not-address-contained	"Test a wildcard as the address" -body {
+		ip contained 10.0.0.0/24 10.*
+	} -returnCodes error -result {Can't parse IP "10.*": ranges and wildcards are only valid in networks lists}
+	test contained-range-ipv4		"Test IPv4 range containment" -body {
+		lmap a {10.0.0.4 10.0.0.5 10.0.0.200 10.0.1.20 10.0.1.21} {ip contained {192.168.0.0/16 10.0.0.5-10.0.1.20} $a}
+	} -result {0 1 1 1 0}
+	test contained-range-ipv6		"Test IPv6 range containment" -body {
+		lmap a {2001:db8::f 2001:db8::10 2001:db8::ffff 2001:db8::1:0 2001:db8::1:1} {ip contained {2001:db8::10-2001:db8::1:0 10.0.0.0/8} $a}
+	} -result {0 1 1 1 0}
+	test contained-wildcard			"Test wildcard containment" -body {
+		lmap a {192.168.4.1 192.169.0.1} {ip contained {192.168.*.*} $a}
+	} -result {1 0}
+	test contained-nested			"Test nested and overlapping networks" -body {
+		lmap a {10.200.0.1 10.1.2.3 11.0.0.1 12.0.0.1 11.0.0.255 11.0.1.0 11.255.255.255 9.255.255.255} {
+			ip contained {10.1.0.0/16 10.0.0.0/8 10.1.2.0/24 11.0.0.0-11.0.0.255 11.0.0.128/25 11.0.1.0-11.255.255.255} $a
+		}
+	} -result {1 1 1 0 1 1 1 0}
+	test contained-adjacent			"Test adjacent networks and ranges merge" -body {
+		lmap a {10.0.0.255 10.0.1.0 10.0.2.0 10.0.2.1 2001:db8::ffff 2001:db8:0:1::1 2001:db8:0:2::} {ip contained {10.0.0.0/24 10.0.1.0-10.0.1.255 10.0.2.0 2001:db8::/64 2001:db8:0:1::-2001:db8:0:1:ffff:ffff:ffff:ffff} $a}
+	} -result {1 1 1 0 1 1 0}
+	test contained-range-partly-mapped	"Test an IPv6 range partly overlapping the IPv4-mapped addresses" -body {
+		lmap a {10.0.0.5 ::ffff:10.0.0.5 9.255.255.255 255.255.255.255 ::1:0:0:0 ::1:0:0:1} {ip contained {::ffff:10.0.0.0-::1:0:0:0} $a}
+	} -result {1 1 0 1 1 0}
+	test contained-cidr-partly-mapped	"Test an IPv6 network and the equivalent range match the same IPv4 addresses" -body {
+		lmap networks {::/64 ::-::ffff:ffff:ffff:ffff ::/0 ::ffff:0:0/95} {
+			lmap a {10.0.0.1 ::ffff:10.0.0.1 ::1 ::1:0:0:0:0} {ip contained $networks $a}
+		}
+	} -result {{1 1 1 0} {1 1 1 0} {1 1 1 1} {1 1 0 0}}
+	test contained-network-address	"Test a network as the address is tested by its address" -body {
+		list [ip contained 10.0.0.0/16 10.0.0.0/8] [ip contained 10.0.0.0/16 10.1.0.0/8] [ip contained 2001:db8::/64 2001:db8::/32] [ip lookup {a 10.0.0.0/16 b 10.1.0.0/16} 10.0.0.0/8]
+	} -result {1 0 1 a}
+
 	# Edge cases
 	test contained-empty-networks			"Test with empty networks list"					{ip contained {} 192.168.1.1}			0
 	test contained-network-with-no-netbits	"Test containment with no netbits specified"	{ip contained 192.168.1.1 192.168.1.1}	1
@@ -144,6 +213,48 @@ namespace eval ::ip::test {
 	#     expr {($end - $start) / 1000.0}
 	# } -match <regexp {^[0-9]+\.[0-9]+$}
 
+	# Tests for mask and key
+	test mask-ipv4				"Test mask of an IPv4 address"				{ip mask 192.168.1.77 24}					192.168.1.0/24
+	test mask-ipv6				"Test mask of an IPv6 address"				{ip mask 2001:db8:1:2:3:4:5:6 56}			2001:db8:1::/56
+	test mask-bits6-ipv4		"Test mask with separate IPv6 bits, IPv4"	{ip mask 10.1.2.3 24 64}					10.1.2.0/24
+	test mask-bits6-ipv6		"Test mask with separate IPv6 bits, IPv6"	{ip mask 2001:db8:1:2:3:4:5:6 24 64}		2001:db8:1:2::/64
+	test mask-ipv4mapped		"Test mask of an IPv4-mapped IPv6 address"	{ip mask ::ffff:10.1.2.3 24 64}				10.1.2.0/24
+	test mask-0					"Test mask to 0 bits"						{ip mask 10.1.2.3 0}						0.0.0.0/0
+	test mask-network			"Test mask of a network"					{ip mask 10.1.2.3/16 8}						10.0.0.0/8
+	test mask-more-bits			"Test mask to more bits than the network has"	{ip mask 10.1.2.3/16 24}				10.1.0.0/16
+	test mask-ipv6-more-bits	"Test mask of an IPv6 network to more bits"		{ip mask ::ffff:10.1.2.3/64 0 128}		::/64
+	test mask-eq				"Test mask result is an ip"					{ip eq [ip mask 10.1.2.3 24] 10.1.2.0/24}	1
+	test mask-contained			"Test mask result as networks"				{ip contained [ip mask 10.1.2.3 24] 10.1.2.200}	1
+	test mask-range				"Test mask of a range" -body {
+		ip mask 10.0.0.1-10.0.0.9 24
+	} -returnCodes error -result {Can't parse IP "10.0.0.1-10.0.0.9": ranges and wildcards are only valid in networks lists}
+	test mask-bad-bits			"Test mask with invalid bits" -body {
+		ip mask 10.1.2.3 33
+	} -returnCodes error -result {Invalid netbits for IPv4: 33 (must be 0-32)}
+	test mask-negative-bits		"Test mask with negative bits" -body {
+		ip mask 10.1.2.3 -1
+	} -returnCodes error -result {Invalid netbits for IPv4: -1 (must be 0-32)}
+	test mask-negative-bits6	"Test mask with negative IPv6 bits" -body {
+		ip mask 2001:db8::1 24 -1
+	} -returnCodes error -result {Invalid netbits for IPv6: -1 (must be 0-128)}
+	test mask-args				"Test mask arg count" -body {
+		ip mask 10.1.2.3
+	} -returnCodes error -result {wrong # args: should be "ip mask address bits ?bits6?"}
+	test key-ipv4				"Test key of an IPv4 address"				{format %llx [ip key 10.1.2.3 24]}			a01020018
+	test key-ipv4-nobits		"Test key with no bits"						{format %llx [ip key 10.1.2.3]}				a01020320
+	test key-ipv6				"Test key of an IPv6 address"				{format %llx [ip key 2001:db8:1:2:3:4:5:6 24 56]}	20010db8000100b8
+	test key-ipv6-long			"Test key of an IPv6 network longer than 56 bits"	{ip key 2001:db8:1:2:3:4:5:6 24 64}	2001:db8:1:2::/64
+	test key-int				"Test keys are integers"					{lmap a {10.1.2.3 ffff::1} {string is wide -strict [ip key $a 24 48]}}	{1 1}
+	test key-ipv4mapped			"Test key of an IPv4-mapped IPv6 address"	{string equal [ip key ::ffff:10.1.2.3 24 64] [ip key 10.1.2.99 24 64]}	1
+	test key-netbits			"Test keys of different size networks differ" -body {
+		llength [lsort -unique [list [ip key 10.0.0.0/8] [ip key 10.0.0.0/16] [ip key 10.0.0.0]]]
+	} -result 3
+	test key-ipv6-not-ipv4		"Test an IPv6 network doesn't share a key with IPv4"	{string equal [ip key ::/8] [ip key 0.0.0.0/8]}	0
+	test key-distinct			"Test keys of different subnets differ"		{string equal [ip key 10.1.2.3 24] [ip key 10.1.3.3 24]}	0
+	test key-range				"Test key of a range" -body {
+		ip key 10.0.0.1-10.0.0.9 24
+	} -returnCodes error -result {Can't parse IP "10.0.0.1-10.0.0.9": ranges and wildcards are only valid in networks lists}
+
 	# Test lookup
 	if 1 {
 	set network_sets [dict create \